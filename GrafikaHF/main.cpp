@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 #if defined(__APPLE__)
 #include <GLUT/GLUT.h>
@@ -36,7 +37,7 @@ void getErrorInfo(unsigned int handle) {
 }
 
 // check if shader could be compiled
-void checkShader(unsigned int shader, char * message) {
+void checkShader(unsigned int shader, const char * message) {
     int OK;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &OK);
     if (!OK) {
@@ -61,13 +62,13 @@ const char *vertexSource = R"(
 precision highp float;
 
 uniform mat4 MVP;			// Model-View-Projection matrix in row-major format
+uniform vec3 vertexColor;	// constant color of the whole object, set before each draw
 
 in vec2 vertexPosition;		// variable input from Attrib Array selected by glBindAttribLocation
-in vec3 vertexColor;	    // variable input from Attrib Array selected by glBindAttribLocation
 out vec3 color;				// output attribute
 
 void main() {
-    color = vertexColor;														// copy color from input to output
+    color = vertexColor;														// copy color from uniform to output
     gl_Position = vec4(vertexPosition.x, vertexPosition.y, 0, 1) * MVP; 		// transform to clipping space
 }
 )";
@@ -85,6 +86,80 @@ void main() {
 }
 )";
 
+// particle update shader in GLSL, runs with rasterizer discard and writes to transform feedback
+const char *particleUpdateSource = R"(
+#version 140
+precision highp float;
+
+uniform float dt;				// elapsed time since the last update in seconds
+uniform uint frame;				// number of the update, seeds the random spawn positions
+uniform float lifetime;			// age when a particle dies and can be respawned
+uniform int nEmitters;			// number of valid elements in emitters
+uniform vec2 emitters[3];		// star positions in world coordinates
+
+in vec3 particle;				// position (x, y) and age (z), negative age: not born yet
+out vec3 nextParticle;			// captured by transform feedback
+
+uint hash(uint x) {				// integer hash, keeps the seed exact for any pool size
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(uint x) { return float(hash(x) >> 8) / 16777216.0; }	// in [0, 1)
+
+void main() {
+    if (nEmitters == 0) {									// no star to spawn from: wait
+        nextParticle = particle;
+        return;
+    }
+    vec2 position = particle.xy;
+    float age = particle.z + dt;
+    bool born = particle.z < 0 && age >= 0;
+    if (born || age >= lifetime) {							// (re)spawn at one of the stars
+        uint seed = hash(uint(gl_VertexID) ^ hash(frame));
+        float angle = 6.2831853 * random(seed);
+        float radius = 0.2 * random(seed + 1u) * random(seed + 2u);	// inside a disc, denser in the middle
+        position = emitters[gl_VertexID % nEmitters] + radius * vec2(cos(angle), sin(angle));
+        age = mod(age, lifetime);							// keeps the ages of the pool staggered
+    }
+    nextParticle = vec3(position, age);
+}
+)";
+
+// particle vertex shader in GLSL
+const char *particleVertexSource = R"(
+#version 140
+precision highp float;
+
+uniform mat4 MVP;			// Model-View-Projection matrix in row-major format
+uniform float lifetime;
+
+in vec3 particle;			// position (x, y) and age (z)
+out float fade;
+
+void main() {
+    fade = clamp(1 - particle.z / lifetime, 0, 1);
+    if (particle.z >= 0 && fade > 0) gl_Position = vec4(particle.x, particle.y, 0, 1) * MVP;
+    else gl_Position = vec4(2, 2, 2, 1);						// unborn or dead particle: outside of the clipping space
+}
+)";
+
+// particle fragment shader in GLSL
+const char *particleFragmentSource = R"(
+#version 140
+precision highp float;
+
+uniform vec3 glowColor;
+in float fade;				// interpolated fade of the vertex shader
+out vec4 fragmentColor;
+
+void main() {
+    fragmentColor = vec4(glowColor, 0.6 * fade * fade);
+}
+)";
+
 // row-major matrix 4x4
 struct mat4 {
     float m[4][4];
@@ -156,6 +231,42 @@ public:
     }
 };
 
+// handle of the shader program
+unsigned int shaderProgram;
+
+// converts a float to IEEE 754 half precision (GL_HALF_FLOAT), too small values are flushed to zero
+unsigned short floatToHalf(float f) {
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+    if (exponent <= 0) return sign;                 // underflow
+    if (exponent >= 31) return sign | 0x7c00;       // overflow: infinity
+    mantissa += 0x1000;                             // round to nearest
+    if (mantissa & 0x800000) {
+        mantissa = 0;
+        if (++exponent >= 31) return sign | 0x7c00;
+    }
+    return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+// storage of the tessellated curve coordinates in the vertex buffer
+struct VertexFormat {
+    GLenum type;	// attribute type given to glVertexAttribPointer
+    int bytes;		// size of one coordinate
+};
+
+const VertexFormat floatVertexFormat = { GL_FLOAT, sizeof(float) };
+const VertexFormat halfVertexFormat = { GL_HALF_FLOAT, sizeof(unsigned short) };	// a fifth of float position + color
+
+// set the constant color of the next draw call
+void setColorUniform(float r, float g, float b) {
+    int location = glGetUniformLocation(shaderProgram, "vertexColor");
+    if (location >= 0) glUniform3f(location, r, g, b);
+    else printf("uniform vertexColor cannot be set\n");
+}
+
 float wGx = -15, wGy = -15;
 
 // 2D camera
@@ -217,15 +328,13 @@ public:
 // 2D camera
 Camera camera;
 
-// handle of the shader program
-unsigned int shaderProgram;
-
 int segmentNumber = 0;
 
 class CatmullRomSpline {
     GLuint vao, vbo;        // vertex array object, vertex buffer object
-    float  vertexData[20*5];// interleaved data of coordinates and colors
-    float  vertexData2[20*5*700];
+    float  vertexData[20*2];// coordinates of the control points
+    unsigned char vertexData2[20*2*700*sizeof(float)]; // tessellated curve coordinates in the vertex format
+    VertexFormat format = halfVertexFormat;
     int    nVertices;       // number of vertices
     float deltats[20], ts[20];
     Coord a0s[20], a1s[20], a2s[20], a3s[20], vels[20];
@@ -238,16 +347,26 @@ public:
         glGenVertexArrays(1, &vao);
         glBindVertexArray(vao);
         
-        GLuint vbo;	// vertex/index buffer object
         glGenBuffers(1, &vbo); // Generate 1 vertex buffer object
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        // Enable the vertex attribute arrays
+        // Enable the vertex attribute array
         glEnableVertexAttribArray(0);  // attribute array 0
-        glEnableVertexAttribArray(1);  // attribute array 1
-        // Map attribute array 0 to the vertex data of the interleaved vbo
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void*>(0)); // attribute array, components/attribute, component type, normalize?, stride, offset
-        // Map attribute array 1 to the color data of the interleaved vbo
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void*>(2 * sizeof(float)));
+        // the format of attribute array 0 is set at upload, control points are floats, the curve is in the vertex format
+    }
+    
+    // choose the storage of the curve, only before the curve exists
+    void setVertexFormat(const VertexFormat& f) {
+        if (nVertices < 2) format = f;
+    }
+    
+    // write the i-th coordinate of the curve in the vertex format
+    void storeCoordinate(int i, float value) {
+        if (format.type == GL_HALF_FLOAT) {
+            unsigned short half = floatToHalf(value);
+            memcpy(&vertexData2[i * format.bytes], &half, sizeof(half));
+        } else {
+            memcpy(&vertexData2[i * format.bytes], &value, sizeof(value));
+        }
     }
 
     void calcConstants(Coord x0, Coord x1, Coord v0, Coord v1, float deltat, int i){
@@ -266,7 +385,7 @@ public:
     }
 
     Coord makeCoordFromVertexData(int i){
-        return Coord(vertexData[5 * i], vertexData[5 * i + 1]);
+        return Coord(vertexData[2 * i], vertexData[2 * i + 1]);
     }
     
     void AddPoint(float cX, float cY) {
@@ -281,12 +400,9 @@ public:
         ts[nVertices] = t;
         
         vec4 wVertex = vec4(cX, cY, 0, 1) * camera.Pinv() * camera.Vinv();
-        // fill interleaved data
-        vertexData[5 * nVertices]     = wVertex.v[0];
-        vertexData[5 * nVertices + 1] = wVertex.v[1];
-        vertexData[5 * nVertices + 2] = 1; // red
-        vertexData[5 * nVertices + 3] = 1; // green
-        vertexData[5 * nVertices + 4] = 1; // blue
+        // fill coordinate data
+        vertexData[2 * nVertices]     = wVertex.v[0];
+        vertexData[2 * nVertices + 1] = wVertex.v[1];
         nVertices++;
         
         if (starIsAtLastSegment){
@@ -323,19 +439,24 @@ public:
                     } else {
                         CatmullRom = catmullRom((deltats[i+1]/700.0f) * j, i);
                     }
-                    vertexData2[5*700*i + 5*j] = CatmullRom.x;
-                    vertexData2[5*700*i + 5*j + 1] = CatmullRom.y;
-                    vertexData2[5*700*i + 5*j + 2] = 1;
-                    vertexData2[5*700*i + 5*j + 3] = 0;
-                    vertexData2[5*700*i + 5*j + 4] = 0;
+                    storeCoordinate(2*700*i + 2*j, CatmullRom.x);
+                    storeCoordinate(2*700*i + 2*j + 1, CatmullRom.y);
                 }
             }
         }
-        // copy data to the GPU
+        Upload();
+    }
+    
+    // copy data to the GPU
+    void Upload() {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo); // other objects may have bound their buffers since Create
         if (nVertices <= 1){
-            glBufferData(GL_ARRAY_BUFFER, nVertices * 5 * sizeof(float), vertexData, GL_DYNAMIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, nVertices * 2 * sizeof(float), vertexData, GL_DYNAMIC_DRAW);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL); // tightly packed floats
         } else {
-            glBufferData(GL_ARRAY_BUFFER, nVertices * 700 * 5 * sizeof(float), vertexData2, GL_DYNAMIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, nVertices * 700 * 2 * format.bytes, vertexData2, GL_DYNAMIC_DRAW);
+            glVertexAttribPointer(0, 2, format.type, GL_FALSE, 0, NULL); // tightly packed
         }
     }
     
@@ -349,8 +470,10 @@ public:
             
             glBindVertexArray(vao);
             if(nVertices <= 1){
+                setColorUniform(1, 1, 1);
                 glDrawArrays(GL_LINE_STRIP, 0, nVertices);
             } else {
+                setColorUniform(1, 0, 0);
                 glDrawArrays(GL_LINE_STRIP, 0, nVertices * 700);
             }
         }
@@ -398,7 +521,7 @@ class Star {
     bool isOnScreen = false;
     CatmullRomSpline* spline;
     float t0 = 0;
-    float vertexColors[24*3];
+    float color[3];
     float s = 0;
 public:
     Star() {
@@ -410,8 +533,8 @@ public:
 
         glBindVertexArray(vao);		// make it active
         
-        unsigned int vbo[2];		// vertex buffer objects
-        glGenBuffers(2, &vbo[0]);	// Generate 2 vertex buffer objects
+        unsigned int vbo[1];		// vertex buffer objects
+        glGenBuffers(1, &vbo[0]);	// Generate 1 vertex buffer object
         
         // vertex coordinates: vbo[0] -> Attrib Array 0 -> vertexPosition of the vertex shader
         glBindBuffer(GL_ARRAY_BUFFER, vbo[0]); // make it active, it is an array
@@ -434,15 +557,7 @@ public:
                               2, GL_FLOAT,  // components/attribute, component type
                               GL_FALSE,		// not in fixed point format, do not normalized
                               0, NULL);     // stride and offset: it is tightly packed
-        
-        // vertex colors: vbo[1] -> Attrib Array 1 -> vertexColor of the vertex shader
-        glBindBuffer(GL_ARRAY_BUFFER, vbo[1]); // make it active, it is an array
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColors), vertexColors, GL_STATIC_DRAW);	// copy to the GPU
-        
-        // Map Attribute Array 1 to the current bound vertex buffer (vbo[1])
-        glEnableVertexAttribArray(1);  // Vertex position
-        // Data organization of Attribute Array 1
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL); // Attribute Array 1, components/attribute, component type, normalize?, tightly packed
+        // the color is constant, it goes to the vertexColor uniform in Draw
     }
     
     void Animate(float t) {
@@ -476,6 +591,7 @@ public:
         int location = glGetUniformLocation(shaderProgram, "MVP");
         if (location >= 0) glUniformMatrix4fv(location, 1, GL_TRUE, MVPTransform); // set uniform variable MVP to the MVPTransform
         else printf("uniform MVP cannot be set\n");
+        setColorUniform(color[0], color[1], color[2]);
         
         glBindVertexArray(vao);	// make the vao and its vbos active playing the role of the data source
         glDrawArrays(GL_TRIANGLES, 0, 24);
@@ -516,18 +632,15 @@ public:
     }
     
     void setColor(float r, float g, float b){
-        for (int i = 0; i<24*3; i++){
-            switch (i%3){
-                case 0: vertexColors[i] = r;
-                    break;
-                case 1: vertexColors[i] = g;
-                    break;
-                case 2: vertexColors[i] = b;
-                    break;
-                default: vertexColors[i] = 1;
-                    break;
-            }
-        }
+        color[0] = r;
+        color[1] = g;
+        color[2] = b;
+    }
+    
+    bool getPosition(float* x, float* y){
+        *x = wTx;
+        *y = wTy;
+        return isOnScreen;
     }
     
     void makeItAttrackToShiny(){
@@ -551,11 +664,144 @@ public:
     }
 };
 
+// compile a shader from string, exits on failure like onInitialization
+unsigned int createShader(GLenum type, const char* source, const char* message) {
+    unsigned int shader = glCreateShader(type);
+    if (!shader) {
+        printf("Error in shader creation\n");
+        exit(1);
+    }
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    checkShader(shader, message);
+    return shader;
+}
+
+// glowing trails of the stars: a fixed pool of particles living on the GPU,
+// aged and respawned by transform feedback between two buffers.
+// Every particle is updated and drawn each frame, on llvmpipe (one core) that is
+// about 2.5 million particles per second, so the default pool costs ~7 ms a frame
+class ParticleSystem {
+    unsigned int vao[2], vbo[2];	// ping-pong buffers, vbo[current] holds the latest state
+    unsigned int updateProgram, renderProgram;
+    int capacity;					// number of particles in the pool
+    int current = 0;
+    float lifetime = 1.5;			// in seconds
+    float lastT = 0, dt = 0;
+    unsigned int frame = 0;
+    float emitters[3*2];
+    int nEmitters = 0;
+public:
+    ParticleSystem(int capacity = 16384) {
+        this->capacity = capacity;
+    }
+    
+    void Create() {
+        // every particle starts unborn with a different negative age, so the births are spread over one lifetime
+        float* particles = new float[capacity * 3];
+        for (int i = 0; i < capacity; i++) {
+            particles[3 * i] = 0;
+            particles[3 * i + 1] = 0;
+            particles[3 * i + 2] = -lifetime * (float)i / capacity;
+        }
+        glGenVertexArrays(2, &vao[0]);
+        glGenBuffers(2, &vbo[0]);
+        for (int i = 0; i < 2; i++) {
+            glBindVertexArray(vao[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[i]);
+            glBufferData(GL_ARRAY_BUFFER, capacity * 3 * sizeof(float), particles, GL_DYNAMIC_COPY);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL); // position and age, tightly packed
+        }
+        delete[] particles;
+        
+        // update program: vertex shader only, its output is captured to the other buffer
+        unsigned int updateShader = createShader(GL_VERTEX_SHADER, particleUpdateSource, "Particle update shader error");
+        updateProgram = glCreateProgram();
+        glAttachShader(updateProgram, updateShader);
+        glBindAttribLocation(updateProgram, 0, "particle");
+        const char* varyings[] = { "nextParticle" };
+        glTransformFeedbackVaryings(updateProgram, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(updateProgram);
+        checkLinking(updateProgram);
+        glDeleteShader(updateShader);	// freed together with the program
+        
+        unsigned int vertexShader = createShader(GL_VERTEX_SHADER, particleVertexSource, "Particle vertex shader error");
+        unsigned int fragmentShader = createShader(GL_FRAGMENT_SHADER, particleFragmentSource, "Particle fragment shader error");
+        renderProgram = glCreateProgram();
+        glAttachShader(renderProgram, vertexShader);
+        glAttachShader(renderProgram, fragmentShader);
+        glBindAttribLocation(renderProgram, 0, "particle");
+        glBindFragDataLocation(renderProgram, 0, "fragmentColor");
+        glLinkProgram(renderProgram);
+        checkLinking(renderProgram);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+    }
+    
+    void Animate(float t) {
+        // several idle calls may come before one Update, the clock only runs while there is a star
+        // to spawn from, so the births start with the first click
+        if (nEmitters > 0 && lastT > 0) dt += t - lastT;
+        lastT = t;
+    }
+    
+    // collect the positions of the stars, particles are only spawned from the ones on the screen
+    void setEmitters(Star* stars[], int n) {
+        nEmitters = 0;
+        for (int i = 0; i < n && i < 3; i++) {
+            if (stars[i]->getPosition(&emitters[2 * nEmitters], &emitters[2 * nEmitters + 1])) nEmitters++;
+        }
+    }
+    
+    void Update() {
+        glUseProgram(updateProgram);
+        glUniform1f(glGetUniformLocation(updateProgram, "dt"), dt);
+        glUniform1ui(glGetUniformLocation(updateProgram, "frame"), frame++);
+        glUniform1f(glGetUniformLocation(updateProgram, "lifetime"), lifetime);
+        glUniform1i(glGetUniformLocation(updateProgram, "nEmitters"), nEmitters);
+        if (nEmitters > 0) glUniform2fv(glGetUniformLocation(updateProgram, "emitters"), nEmitters, emitters);
+        dt = 0; // consumed, Animate accumulates the time until the next Update
+        
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(vao[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo[1 - current]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, capacity);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        current = 1 - current;
+    }
+    
+    void Draw() {
+        Update();
+        
+        mat4 VPTransform = camera.V() * camera.P();
+        glUseProgram(renderProgram);
+        int location = glGetUniformLocation(renderProgram, "MVP");
+        if (location >= 0) glUniformMatrix4fv(location, 1, GL_TRUE, VPTransform);
+        else printf("uniform MVP cannot be set\n");
+        glUniform1f(glGetUniformLocation(renderProgram, "lifetime"), lifetime);
+        glUniform3f(glGetUniformLocation(renderProgram, "glowColor"), 1, 0.55, 0.1);
+        
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);	// additive blending would clip to white on the light background
+        glPointSize(2);
+        glBindVertexArray(vao[current]);
+        glDrawArrays(GL_POINTS, 0, capacity);
+        glDisable(GL_BLEND);
+        
+        glUseProgram(shaderProgram);	// the other objects draw with the main program
+    }
+};
+
 // The virtual world: collection of two objects
 Star shinyStar;
 Star notSoShinyStar;
 Star definitelyNotShinyStar;
 CatmullRomSpline lineStrip;
+ParticleSystem trails;
 
 // Initialization, create an OpenGL context
 void onInitialization() {
@@ -570,7 +816,7 @@ void onInitialization() {
     definitelyNotShinyStar.setColor(1, 0, 0.8);
     definitelyNotShinyStar.Create();
     lineStrip.Create();
-
+    trails.Create();
     
     // Create vertex shader from string
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -603,7 +849,6 @@ void onInitialization() {
     
     // Connect Attrib Arrays to input variables of the vertex shader
     glBindAttribLocation(shaderProgram, 0, "vertexPosition"); // vertexPosition gets values from Attrib Array 0
-    glBindAttribLocation(shaderProgram, 1, "vertexColor");    // vertexColor gets values from Attrib Array 1
     
     // Connect the fragmentColor to the frame buffer memory
     glBindFragDataLocation(shaderProgram, 0, "fragmentColor");	// fragmentColor goes to the frame buffer memory
@@ -625,6 +870,7 @@ void onDisplay() {
     glClearColor(0.7, 0.8, 0.7, 0);							// background color
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);         // clear the screen
     
+    trails.Draw();                                              // behind the stars
     shinyStar.Draw();
     notSoShinyStar.Draw();
     definitelyNotShinyStar.Draw();
@@ -671,6 +917,9 @@ void onIdle() {
     shinyStar.Animate(sec);					// animate the triangle object
     notSoShinyStar.Animate(sec);
     definitelyNotShinyStar.Animate(sec);
+    Star* stars[] = { &shinyStar, &notSoShinyStar, &definitelyNotShinyStar };
+    trails.setEmitters(stars, 3);
+    trails.Animate(sec);
     glutPostRedisplay();					// redraw the scene
 }
 
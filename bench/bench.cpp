@@ -0,0 +1,359 @@
+// Benchmarks of the hot paths of GrafikaHF/main.cpp.
+// The homework is compiled into this file with its main renamed, GLUT time and
+// buffer swapping are stubbed, and everything runs on a headless EGL context
+// (llvmpipe on machines without a GPU). Results are written as JSON.
+#include <EGL/egl.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#define main app_main
+#include "../GrafikaHF/main.cpp"
+#undef main
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GLUT stubs, the clock is driven by the benchmarks
+
+int benchTime = 0; // elapsed time reported by glutGet in msec
+
+int glutGet(GLenum query) {
+    return query == GLUT_ELAPSED_TIME ? benchTime : 0;
+}
+
+void glutSwapBuffers() {
+    glFinish(); // frames are timed until the rendering is done
+}
+
+void glutPostRedisplay() {
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Measurement
+
+struct Result {
+    std::string name, unit;
+    double value;
+    bool higherIsBetter;
+};
+
+std::vector<Result> results;
+
+void report(const char* name, const char* unit, double value, bool higherIsBetter = false) {
+    Result r = { name, unit, value, higherIsBetter };
+    results.push_back(r);
+    fprintf(stderr, "%-32s %14.1f %s\n", name, value, unit);
+}
+
+double seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+const int rounds = 5; // the best of the rounds is reported, the others are noise of the machine
+
+// grows a batch of op calls until it takes at least minSeconds / rounds,
+// then times rounds batches and returns the best nsec per call
+template <typename Op>
+double nsPerOp(Op op, double minSeconds = 0.5) {
+    long n = 1;
+    double best = 0;
+    for (int round = 0; round < rounds; ) {
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < n; i++) op();
+        double elapsed = seconds(std::chrono::steady_clock::now() - start);
+        if (round == 0 && elapsed < minSeconds / rounds) {
+            n *= 2;
+            continue;
+        }
+        if (round == 0 || elapsed * 1e9 / n < best) best = elapsed * 1e9 / n;
+        round++;
+    }
+    return best;
+}
+
+volatile float sink; // keeps the results of pure computations alive
+
+// normalized device coordinates of the i-th click on a circle
+void clickCoords(int i, float* cX, float* cY) {
+    float phi = 2 * M_PI * i / 20;
+    *cX = 0.6f * cosf(phi);
+    *cY = 0.6f * sinf(phi);
+}
+
+// fills the spline with n control points clicked 300 msec apart
+void fillSpline(CatmullRomSpline& spline, int n) {
+    for (int i = 0; i < n; i++) {
+        float cX, cY;
+        clickCoords(i, &cX, &cY);
+        benchTime += 300;
+        spline.AddPoint(cX, cY);
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Benchmarks
+
+void benchAddPoint() {
+    const int counts[] = { 2, 5, 10, 15, 20 };
+    for (int n : counts) {
+        CatmullRomSpline base;
+        base.Create();
+        fillSpline(base, n - 1);
+        float cX, cY;
+        clickCoords(n - 1, &cX, &cY);
+        int clickTime = benchTime + 300; // every call adds the same point at the same time
+        // only the n-th AddPoint is timed, the copy resets the spline to n-1 points,
+        // the best median of the rounds is reported
+        double best = 0;
+        for (int round = 0; round < rounds; round++) {
+            std::vector<double> calls;
+            double total = 0;
+            while (total < 0.5 / rounds) {
+                CatmullRomSpline spline = base;
+                int savedSegment = segmentNumber;
+                benchTime = clickTime;
+                auto start = std::chrono::steady_clock::now();
+                spline.AddPoint(cX, cY);
+                double elapsed = seconds(std::chrono::steady_clock::now() - start);
+                segmentNumber = savedSegment;
+                calls.push_back(elapsed);
+                total += elapsed;
+            }
+            std::sort(calls.begin(), calls.end());
+            double median = calls[calls.size() / 2] * 1e9;
+            if (round == 0 || median < best) best = median;
+        }
+        char name[64];
+        sprintf(name, "spline_addpoint_%d", n);
+        report(name, "ns/op", best);
+    }
+}
+
+void benchSplineEvaluation() {
+    static CatmullRomSpline spline;
+    spline.Create();
+    fillSpline(spline, 20);
+
+    float t = 0;
+    int i = 0;
+    report("spline_catmullrom", "ns/op", nsPerOp([&] {
+        Coord c = spline.catmullRom(t, i);
+        sink = c.x + c.y;
+        t += 1.0f;
+        if (t >= 300) { t = 0; i = (i + 1) % 20; }
+    }));
+
+    // the clocks are floats in main.cpp: restart them before they lose the msec steps
+    segmentNumber = 0;
+    float t0 = 1;
+    float tms = 1;
+    report("spline_poswhent", "ns/op", nsPerOp([&] {
+        Coord c = spline.posWhenT(tms, &t0);
+        sink = c.x + c.y;
+        tms += 1.0f;
+        if (tms > 100000) {
+            tms = t0 = 1;
+            segmentNumber = 0;
+        }
+    }));
+}
+
+// size of the buffer bound to GL_ARRAY_BUFFER
+int boundBufferBytes() {
+    int bytes;
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+    return bytes;
+}
+
+void benchVertexUpload() {
+    static CatmullRomSpline halfSpline, floatSpline; // static: too big for the stack
+    halfSpline.Create();
+    fillSpline(halfSpline, 20); // AddPoint leaves its vbo bound
+    report("spline_upload_bytes_20", "bytes", boundBufferBytes());
+    floatSpline.setVertexFormat(floatVertexFormat);
+    floatSpline.Create();
+    fillSpline(floatSpline, 20);
+    report("spline_upload_bytes_20_float", "bytes", boundBufferBytes());
+
+    static Star star; // static: Star leaves its spline pointer uninitialized
+    star.setColor(1, 1, 1);
+    star.Create(); // Create leaves its vbo bound
+    report("star_vbo_bytes", "bytes", boundBufferBytes());
+
+    // the upload of AddPoint without the tessellation
+    report("spline_upload_20", "ns/op", nsPerOp([&] {
+        halfSpline.Upload();
+        glFinish();
+    }));
+    report("spline_upload_20_float", "ns/op", nsPerOp([&] {
+        floatSpline.Upload();
+        glFinish();
+    }));
+}
+
+void benchMatrices() {
+    float c = cosf(0.01f), s = sinf(0.01f);
+    mat4 rotation(c, -s, 0, 0,
+                  s,  c, 0, 0,
+                  0,  0, 1, 0,
+                  0,  0, 0, 1);
+    mat4 m = rotation;
+    report("mat4_multiply", "ns/op", nsPerOp([&] {
+        m = m * rotation; // each product depends on the previous one
+    }));
+    sink = m.m[0][0];
+
+    vec4 v(1, 2, 0, 1);
+    report("vec4_times_mat4", "ns/op", nsPerOp([&] {
+        v = v * rotation;
+    }));
+    sink = v.v[0];
+}
+
+void benchStarAnimate() {
+    static CatmullRomSpline spline;
+    static Star followingStar, attractedStar; // static: Star leaves its spline pointer uninitialized
+    spline.Create();
+    fillSpline(spline, 4);
+    followingStar.setSpline(&spline);
+    followingStar.setCoordinatesFirstTime(0.5, 0.5);
+    attractedStar.setCoordinatesFirstTime(-0.5, -0.5);
+    segmentNumber = 0;
+    // copies of the starting state, the clocks are restarted before they lose the frame steps
+    static Star followingStart, attractedStart;
+    followingStart = followingStar;
+    attractedStart = attractedStar;
+
+    float t = 1;
+    report("star_animate_attracted", "ns/op", nsPerOp([&] {
+        attractedStar.Animate(t);
+        t += 0.016f;
+        if (t > 1000) {
+            t = 1;
+            attractedStar = attractedStart;
+        }
+    }));
+    t = 1;
+    report("star_animate_catmull", "ns/op", nsPerOp([&] {
+        followingStar.Animate(t);
+        t += 0.016f;
+        if (t > 1000) {
+            t = 1;
+            followingStar = followingStart;
+            segmentNumber = 0;
+        }
+    }));
+}
+
+void benchFrames() {
+    onInitialization();
+    segmentNumber = 0;
+    for (int i = 0; i < 4; i++) { // the scene of the homework: four clicks
+        float cX, cY;
+        clickCoords(5 * i, &cX, &cY);
+        int pX = (int)((cX + 1) * windowWidth / 2), pY = (int)((1 - cY) * windowHeight / 2);
+        benchTime += 300;
+        onMouse(GLUT_LEFT_BUTTON, GLUT_DOWN, pX, pY);
+    }
+    report("frame_ondisplay", "ns/frame", nsPerOp([&] {
+        benchTime += 16;
+        onIdle();
+        onDisplay();
+    }, 2.0));
+}
+
+// runs after benchFrames: the stars of the scene are on the screen and emit particles
+void benchParticles() {
+    const int capacities[] = { 4096, 16384, 65536, 262144, 1048576 };
+    Star* stars[] = { &shinyStar, &notSoShinyStar, &definitelyNotShinyStar };
+    for (int capacity : capacities) {
+        static std::vector<ParticleSystem*> pools; // GL objects of the pools are never released
+        ParticleSystem* particles = new ParticleSystem(capacity);
+        pools.push_back(particles);
+        particles->Create();
+        // one lifetime in a single step: the whole pool is born, with staggered ages
+        particles->setEmitters(stars, 3);
+        particles->Animate(benchTime / 1000.0f);
+        benchTime += 2000;
+        particles->Animate(benchTime / 1000.0f);
+        particles->Draw();
+        double ns = nsPerOp([&] {
+            benchTime += 16;
+            particles->setEmitters(stars, 3);
+            particles->Animate(benchTime / 1000.0f);
+            particles->Draw(); // update and render
+            glFinish();
+        });
+        char name[64];
+        sprintf(name, "particles_%d", capacity);
+        report(name, "particles/s", capacity * 1e9 / ns, true);
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// headless OpenGL 3.0 context on a pbuffer of the window size
+bool createContext() {
+    setenv("EGL_PLATFORM", "surfaceless", 0);
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) return false;
+
+    EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                               EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE };
+    EGLConfig config;
+    EGLint nConfigs;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &nConfigs) || nConfigs < 1) return false;
+
+    EGLint surfaceAttribs[] = { EGL_WIDTH, (EGLint)windowWidth, EGL_HEIGHT, (EGLint)windowHeight, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE) return false;
+
+    eglBindAPI(EGL_OPENGL_API);
+    EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, majorVersion, EGL_CONTEXT_MINOR_VERSION, minorVersion, EGL_NONE };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) return false;
+    return eglMakeCurrent(display, surface, surface, context);
+}
+
+void writeJson(FILE* out) {
+    fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"benchmarks\": [\n", glGetString(GL_RENDERER));
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.1f, \"higher_is_better\": %s}%s\n",
+                r.name.c_str(), r.unit.c_str(), r.value, r.higherIsBetter ? "true" : "false",
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// usage: grafika_bench [results.json], writes to stdout without argument
+int main(int argc, char* argv[]) {
+    if (!createContext()) {
+        fprintf(stderr, "Cannot create a headless OpenGL %d.%d context\n", majorVersion, minorVersion);
+        return 1;
+    }
+    fprintf(stderr, "GL Renderer  : %s\n", glGetString(GL_RENDERER));
+
+    benchAddPoint();
+    benchSplineEvaluation();
+    benchVertexUpload();
+    benchMatrices();
+    benchStarAnimate();
+    benchFrames();
+    benchParticles();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        fprintf(stderr, "GL error 0x%x during the benchmarks\n", error);
+        return 1;
+    }
+
+    FILE* out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    writeJson(out);
+    if (out != stdout) fclose(out);
+    return 0;
+}
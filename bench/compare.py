@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Compare benchmark results against a baseline and flag regressions.
+
+usage: compare.py baseline.json results.json [results2.json ...] [--threshold 0.2]
+       compare.py --write-baseline baseline.json results.json [results2.json ...]
+
+With several results files the best value of each benchmark is compared, so
+a regression has to show up in every run to be flagged. Exits with 1 if any
+benchmark is worse than the baseline by more than the threshold (a fraction,
+0.2 = 20%) or is missing from the results.
+
+--write-baseline stores the median of each benchmark over the results files,
+a typical value rather than the luckiest one.
+"""
+import argparse
+import json
+import statistics
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+
+def best_of(runs):
+    best = {}
+    for run in runs:
+        for name, b in run.items():
+            if name not in best:
+                best[name] = b
+            elif b["higher_is_better"] and b["value"] > best[name]["value"]:
+                best[name] = b
+            elif not b["higher_is_better"] and b["value"] < best[name]["value"]:
+                best[name] = b
+    return best
+
+
+def write_median(path, runs):
+    runs = list(runs)
+    with open(runs[0]) as f:
+        out = json.load(f)
+    values = {}
+    for run in runs:
+        for name, b in load(run).items():
+            values.setdefault(name, []).append(b["value"])
+    for b in out["benchmarks"]:
+        b["value"] = round(statistics.median(values[b["name"]]), 1)
+    with open(path, "w") as f:
+        json.dump(out, f, indent=2)
+        f.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("results", nargs="+")
+    parser.add_argument("--threshold", type=float, default=0.2,
+                        help="allowed slowdown as a fraction (default: 0.2)")
+    parser.add_argument("--write-baseline", action="store_true",
+                        help="write the medians of the results to the baseline instead of comparing")
+    args = parser.parse_args()
+
+    if args.write_baseline:
+        write_median(args.baseline, args.results)
+        return 0
+
+    baseline = load(args.baseline)
+    results = best_of(load(path) for path in args.results)
+
+    failed = False
+    for name, base in baseline.items():
+        if name not in results:
+            print("MISSING     %-32s" % name)
+            failed = True
+            continue
+        value = results[name]["value"]
+        # change > 0 is always worse, whichever direction is better for the unit
+        if base["higher_is_better"]:
+            change = base["value"] / value - 1 if value > 0 else float("inf")
+        else:
+            change = value / base["value"] - 1 if base["value"] > 0 else 0.0
+        status = "REGRESSION" if change > args.threshold else "ok"
+        failed |= status == "REGRESSION"
+        print("%-11s %-32s %14.1f -> %14.1f %-10s (%+.1f%%)"
+              % (status, name, base["value"], value, base["unit"], 100 * change))
+    for name in results:
+        if name not in baseline:
+            print("NEW         %-32s %14.1f %s" % (name, results[name]["value"], results[name]["unit"]))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,14 @@
+// Stand-in for GLEW when building the benchmarks.
+// The benchmarks run on a headless EGL context where GLEW cannot load the
+// entry points, so the GL 3.0 functions are taken directly from libGL.
+#ifndef BENCH_GLEW_H
+#define BENCH_GLEW_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+static bool glewExperimental;
+static inline int glewInit() { return 0; }
+
+#endif